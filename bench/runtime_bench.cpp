@@ -0,0 +1,217 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#define main runtime_cli_main
+#include "../main.cpp"
+#undef main
+
+// Latency benchmark harness for the container lifecycle hot paths. Reports
+// p50/p95/p99 and ops/sec per phase so a 2 ms create regression is visible in
+// CI instead of drowned in shell-wrapper noise. Micro-benchmarks always run;
+// the full lifecycle loop (clone, mounts, cgroups) needs root and namespaces,
+// so it is gated behind --full.
+
+struct BenchOptions {
+    bool json = false;
+    bool full = false;
+    int iterations = 200;
+    std::string bundle;
+};
+
+struct BenchResult {
+    std::string name;
+    size_t iterations = 0;
+    double p50_us = 0;
+    double p95_us = 0;
+    double p99_us = 0;
+    double ops_per_sec = 0;
+};
+
+double percentile(std::vector<double>& sorted_samples, double fraction) {
+    if (sorted_samples.empty()) {
+        return 0;
+    }
+    size_t index = static_cast<size_t>(fraction * (sorted_samples.size() - 1));
+    return sorted_samples[index];
+}
+
+template <typename Fn>
+BenchResult run_bench(const std::string& name, int iterations, Fn&& fn) {
+    std::vector<double> samples;
+    samples.reserve(iterations);
+    double total_us = 0;
+    for (int i = 0; i < iterations; ++i) {
+        auto begin = std::chrono::steady_clock::now();
+        fn(i);
+        auto end = std::chrono::steady_clock::now();
+        double us = std::chrono::duration<double, std::micro>(end - begin).count();
+        samples.push_back(us);
+        total_us += us;
+    }
+    std::sort(samples.begin(), samples.end());
+    BenchResult result;
+    result.name = name;
+    result.iterations = samples.size();
+    result.p50_us = percentile(samples, 0.50);
+    result.p95_us = percentile(samples, 0.95);
+    result.p99_us = percentile(samples, 0.99);
+    result.ops_per_sec = total_us > 0 ? (samples.size() * 1000000.0 / total_us) : 0;
+    return result;
+}
+
+void report(const std::vector<BenchResult>& results, bool as_json) {
+    if (as_json) {
+        json doc = json::array();
+        for (const auto& result : results) {
+            doc.push_back(json{
+                    {"name", result.name},
+                    {"iterations", result.iterations},
+                    {"p50_us", result.p50_us},
+                    {"p95_us", result.p95_us},
+                    {"p99_us", result.p99_us},
+                    {"ops_per_sec", result.ops_per_sec}
+            });
+        }
+        std::cout << doc.dump() << std::endl;
+        return;
+    }
+    std::printf("%-28s %8s %10s %10s %10s %12s\n",
+                "BENCHMARK", "ITERS", "P50(us)", "P95(us)", "P99(us)", "OPS/SEC");
+    for (const auto& result : results) {
+        std::printf("%-28s %8zu %10.1f %10.1f %10.1f %12.1f\n",
+                    result.name.c_str(), result.iterations,
+                    result.p50_us, result.p95_us, result.p99_us,
+                    result.ops_per_sec);
+    }
+}
+
+std::string write_bench_bundle(const std::string& dir) {
+    ensure_directory(dir + "/rootfs/bin", 0755);
+    ensure_directory(dir + "/rootfs/proc", 0755);
+    std::ofstream ofs(dir + "/config.json");
+    ofs << R"({
+        "ociVersion": "1.0.2",
+        "root": {"path": "rootfs"},
+        "process": {"args": ["/bin/true"],
+                    "env": ["PATH=/bin", "A=1", "B=2", "C=3"], "cwd": "/"},
+        "hostname": "bench",
+        "mounts": [
+            {"destination": "/tmp", "type": "tmpfs", "source": "tmpfs",
+             "options": ["nosuid"]},
+            {"destination": "/data", "type": "bind", "source": "rootfs/bin",
+             "options": ["rbind", "ro"]}
+        ],
+        "linux": {"namespaces": [{"type": "pid"}, {"type": "uts"}, {"type": "mnt"}]}
+    })";
+    return dir;
+}
+
+int main(int argc, char* argv[]) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--json") {
+            options.json = true;
+        } else if (arg == "--full") {
+            options.full = true;
+        } else if (arg == "--iterations" && i + 1 < argc) {
+            options.iterations = std::atoi(argv[++i]);
+        } else if (arg == "--bundle" && i + 1 < argc) {
+            options.bundle = argv[++i];
+        } else {
+            std::cerr << "Usage: runtime_bench [--json] [--full] [--iterations n] [--bundle dir]" << std::endl;
+            return 1;
+        }
+    }
+    if (options.iterations < 1) {
+        options.iterations = 1;
+    }
+
+    std::string root = "/tmp/runway-bench-" + std::to_string(getpid());
+    ensure_directory(root, 0755);
+    g_global_options.root_path = root;
+    std::string bundle = options.bundle.empty()
+            ? write_bench_bundle(root + "/bundle") : options.bundle;
+
+    std::vector<BenchResult> results;
+
+    // Config parse: cold SAX parse each iteration (cache defeated by going
+    // through load_config directly).
+    results.push_back(run_bench("load_config(sax)", options.iterations, [&](int) {
+        OCIConfig config = load_config(bundle);
+        (void)config;
+    }));
+
+    // Resolved-config path: first iteration warms the binary cache, the rest
+    // measure the mmap+decode hit.
+    results.push_back(run_bench("load_resolved_config(cache)", options.iterations, [&](int) {
+        OCIConfig config = load_resolved_config(bundle);
+        (void)config;
+    }));
+
+    ContainerState bench_state;
+    bench_state.id = "bench-state";
+    bench_state.pid = getpid();
+    bench_state.status = "running";
+    bench_state.bundle_path = bundle;
+    bench_state.annotations["runway.version"] = RUNTIME_VERSION;
+    results.push_back(run_bench("save_state", options.iterations, [&](int) {
+        save_state(bench_state);
+    }));
+    results.push_back(run_bench("load_state(cold)", options.iterations, [&](int) {
+        invalidate_state_cache(bench_state.id);
+        ContainerState state = load_state(bench_state.id);
+        (void)state;
+    }));
+
+    results.push_back(run_bench("collect_container_pids", options.iterations, [&](int) {
+        invalidate_container_pid_cache(bench_state.id);
+        std::vector<pid_t> pids = collect_container_pids(bench_state);
+        (void)pids;
+    }));
+
+    results.push_back(run_bench("record_event", options.iterations, [&](int i) {
+        record_event(bench_state.id, "bench", json{{"iteration", i}});
+    }));
+
+    if (options.full) {
+        if (geteuid() != 0) {
+            std::cerr << "--full requires root; skipping lifecycle benchmarks" << std::endl;
+        } else {
+            int lifecycle_iters = std::min(options.iterations, 50);
+            int counter = 0;
+            results.push_back(run_bench("create+start+delete", lifecycle_iters, [&](int) {
+                std::string id = "bench-" + std::to_string(getpid()) + "-" +
+                                 std::to_string(counter++);
+                CreateOptions create_opts;
+                create_opts.id = id;
+                create_opts.bundle = bundle;
+                create_opts.socket_sync = true;
+                create_container(create_opts);
+                start_container(id, false);
+                ContainerState state = load_state(id);
+                if (state.pid > 0) {
+                    waitpid(state.pid, nullptr, 0);
+                }
+                delete_container(id, true);
+            }));
+        }
+    }
+
+    report(results, options.json);
+
+    // Clean up the benchmark state root. Note: no delete_container here - the
+    // bench state carries our own pid, and a force delete would SIGKILL the
+    // benchmark's own process tree.
+    std::string cleanup = "rm -rf " + root;
+    if (std::system(cleanup.c_str()) != 0) {
+        std::cerr << "Warning: failed to clean bench root " << root << std::endl;
+    }
+    return 0;
+}
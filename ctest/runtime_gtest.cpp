@@ -106,17 +106,96 @@ TEST_F(RuntimeFixture, ParseEventsOptionsParsesInterval) {
     EXPECT_EQ("demo", opts.id);
 }
 
+TEST_F(RuntimeFixture, LoadConfigSaxMatchesDomParse) {
+    fs::path bundle = fs::path(root) / "bundle";
+    fs::create_directories(bundle);
+    std::string config_json = R"({
+        "ociVersion": "1.0.2",
+        "root": {"path": "rootfs", "readonly": true},
+        "process": {"args": ["/bin/true"], "env": ["A=1"], "cwd": "/opt"},
+        "mounts": [{"destination": "/tmp", "type": "tmpfs", "options": ["nosuid"]}],
+        "linux": {"resources": {"memory": {"limit": 4096},
+                  "cpu": {"cpus": "0-1", "mems": "0"},
+                  "blockIO": {"weight": 250,
+                              "throttleReadBpsDevice": [{"major": 8, "minor": 0, "rate": 1048576}]}}},
+        "unknownVendorField": {"ignored": [true, null]}
+    })";
+    std::ofstream(bundle / "config.json") << config_json;
+
+    OCIConfig config = load_config(bundle.string());
+    OCIConfig dom_config = json::parse(config_json).get<OCIConfig>();
+
+    EXPECT_EQ(dom_config.ociVersion, config.ociVersion);
+    EXPECT_EQ(dom_config.root.path, config.root.path);
+    EXPECT_EQ(dom_config.root.readonly, config.root.readonly);
+    EXPECT_EQ(dom_config.process.args, config.process.args);
+    EXPECT_EQ(dom_config.process.env, config.process.env);
+    EXPECT_EQ(dom_config.process.cwd, config.process.cwd);
+    ASSERT_EQ(1u, config.mounts.size());
+    EXPECT_EQ(dom_config.mounts[0].options, config.mounts[0].options);
+    EXPECT_EQ(4096, config.linux.resources.memory_limit);
+    EXPECT_EQ(dom_config.linux.resources.cpuset_cpus, config.linux.resources.cpuset_cpus);
+    EXPECT_EQ(dom_config.linux.resources.blkio_weight, config.linux.resources.blkio_weight);
+    ASSERT_EQ(1u, config.linux.resources.blkio_read_bps.size());
+    EXPECT_EQ(dom_config.linux.resources.blkio_read_bps[0].rate,
+              config.linux.resources.blkio_read_bps[0].rate);
+}
+
+TEST_F(RuntimeFixture, CompiledConfigCacheRoundTrips) {
+    fs::path bundle = fs::path(root) / "bundle";
+    fs::create_directories(bundle / "rootfs");
+    std::ofstream(bundle / "config.json") << R"({
+        "ociVersion": "1.0.2",
+        "root": {"path": "rootfs", "readonly": true},
+        "process": {"args": ["/bin/true", "-v"], "env": ["K=V"], "cwd": "/x"},
+        "hostname": "cached",
+        "mounts": [{"destination": "/d", "type": "bind", "source": "data",
+                    "options": ["rbind"]}],
+        "linux": {"resources": {"cpu": {"shares": 256}},
+                  "maskedPaths": ["/proc/kcore"]},
+        "annotations": {"a": "b"},
+        "hooks": {"poststop": [{"path": "/bin/h", "timeout": 2}]}
+    })";
+
+    OCIConfig first = load_resolved_config(bundle.string());
+    ASSERT_TRUE(fs::exists(fs::path(state_base_path()) / "config_cache"));
+    OCIConfig second = load_resolved_config(bundle.string());
+
+    EXPECT_EQ(first.ociVersion, second.ociVersion);
+    EXPECT_EQ(first.hostname, second.hostname);
+    EXPECT_EQ(first.root.path, second.root.path);
+    EXPECT_EQ(first.root.readonly, second.root.readonly);
+    EXPECT_EQ(first.process.args, second.process.args);
+    EXPECT_EQ(first.process.env, second.process.env);
+    ASSERT_EQ(1u, second.mounts.size());
+    // Mount sources are bundle-resolved before caching.
+    EXPECT_EQ((bundle / "data").string(), second.mounts[0].source);
+    EXPECT_EQ(first.mounts[0].options, second.mounts[0].options);
+    EXPECT_EQ(256, second.linux.resources.cpu_shares);
+    EXPECT_EQ(first.linux.masked_paths, second.linux.masked_paths);
+    EXPECT_EQ("b", second.annotations.at("a"));
+    ASSERT_EQ(1u, second.hooks.poststop.size());
+    EXPECT_EQ(2, second.hooks.poststop[0].timeout);
+
+    // Rewriting config.json must invalidate the cache entry.
+    std::ofstream(bundle / "config.json") << R"({
+        "ociVersion": "1.0.2",
+        "root": {"path": "rootfs"},
+        "process": {"args": ["/bin/false"]}
+    })";
+    OCIConfig third = load_resolved_config(bundle.string());
+    ASSERT_EQ(1u, third.process.args.size());
+    EXPECT_EQ("/bin/false", third.process.args[0]);
+}
+
 TEST_F(RuntimeFixture, RecordEventWritesJsonLine) {
     std::string id = "record-event";
     record_event(id, "lifecycle", json{{"status", "created"}});
-    fs::path event_path = fs::path(state_base_path()) / id / "events.log";
+    fs::path event_path = fs::path(state_base_path()) / id / "events.ring";
     ASSERT_TRUE(fs::exists(event_path));
-    std::ifstream ifs(event_path);
-    ASSERT_TRUE(ifs.good());
-    std::string line;
-    std::getline(ifs, line);
-    ASSERT_FALSE(line.empty());
-    json entry = json::parse(line, nullptr, false);
+    std::vector<std::string> payloads = read_event_journal_payloads(id);
+    ASSERT_FALSE(payloads.empty());
+    json entry = json::parse(payloads.front(), nullptr, false);
     ASSERT_FALSE(entry.is_discarded());
     EXPECT_EQ("lifecycle", entry["type"]);
     EXPECT_EQ(id, entry["id"]);
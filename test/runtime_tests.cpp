@@ -43,7 +43,7 @@ void cleanup_state_root(const std::string& root, const std::string& id) {
         base.pop_back();
     }
     std::string event_dir = state_base_path() + id;
-    std::string event_file = event_dir + "/events.log";
+    std::string event_file = event_dir + "/events.ring";
     unlink(event_file.c_str());
     rmdir(event_dir.c_str());
     rmdir(base.c_str());
@@ -122,6 +122,96 @@ void test_parse_events_options(TestContext& ctx) {
     ctx.expect(options.id == "demo", "parse_events_options id", options.id);
 }
 
+void test_load_config_sax(TestContext& ctx) {
+    std::string bundle = "/tmp/runway-test-bundle-" + std::to_string(getpid());
+    ensure_directory(bundle, 0755);
+    std::string config_json = R"({
+        "ociVersion": "1.0.2",
+        "root": {"path": "rootfs", "readonly": true},
+        "process": {
+            "terminal": false,
+            "args": ["/bin/sh", "-c", "echo hi"],
+            "env": ["PATH=/bin", "FOO=bar"],
+            "cwd": "/srv"
+        },
+        "hostname": "saxtest",
+        "mounts": [
+            {"destination": "/proc", "type": "proc", "source": "proc"},
+            {"destination": "/data", "type": "bind", "source": "/tmp/data",
+             "options": ["rbind", "ro"]}
+        ],
+        "linux": {
+            "namespaces": [{"type": "pid"}, {"type": "net", "path": "/proc/1/ns/net"}],
+            "resources": {"memory": {"limit": 1048576}, "cpu": {"shares": 512}},
+            "uidMappings": [{"hostID": 1000, "containerID": 0, "size": 1}],
+            "maskedPaths": ["/proc/kcore"],
+            "rootfsPropagation": "rslave",
+            "cgroupsPath": "/custom/path"
+        },
+        "annotations": {"com.example.key": "value"},
+        "hooks": {
+            "createRuntime": [{"path": "/bin/hook", "args": ["hook", "-v"], "timeout": 5}],
+            "poststop": [{"path": "/bin/cleanup"}]
+        },
+        "someFutureExtension": {"nested": [1, 2, {"deep": true}]}
+    })";
+    {
+        std::ofstream ofs(bundle + "/config.json");
+        ofs << config_json;
+    }
+
+    OCIConfig config = load_config(bundle);
+    OCIConfig dom_config = json::parse(config_json).get<OCIConfig>();
+
+    ctx.expect(config.ociVersion == "1.0.2", "load_config ociVersion", config.ociVersion);
+    ctx.expect(config.root.path == "rootfs" && config.root.readonly, "load_config root");
+    ctx.expect(config.process.args == dom_config.process.args, "load_config process args");
+    ctx.expect(config.process.env == dom_config.process.env, "load_config process env");
+    ctx.expect(config.process.cwd == "/srv", "load_config process cwd", config.process.cwd);
+    ctx.expect(config.hostname == "saxtest", "load_config hostname", config.hostname);
+    ctx.expect(config.mounts.size() == 2, "load_config mount count");
+    if (config.mounts.size() == 2) {
+        ctx.expect(config.mounts[1].options == dom_config.mounts[1].options,
+                   "load_config mount options");
+    }
+    ctx.expect(config.linux.namespaces.size() == 2 &&
+               config.linux.namespaces[1].path == "/proc/1/ns/net",
+               "load_config namespaces");
+    ctx.expect(config.linux.resources.memory_limit == 1048576 &&
+               config.linux.resources.cpu_shares == 512,
+               "load_config resources");
+    ctx.expect(config.linux.uid_mappings.size() == 1 &&
+               config.linux.uid_mappings[0].host_id == 1000 &&
+               config.linux.uid_mappings[0].size == 1,
+               "load_config uid mappings");
+    ctx.expect(config.linux.rootfs_propagation == "rslave", "load_config propagation");
+    ctx.expect(config.linux.cgroups_path == "/custom/path", "load_config cgroups path");
+    ctx.expect(config.annotations.at("com.example.key") == "value", "load_config annotations");
+    ctx.expect(config.hooks.create_runtime.size() == 1 &&
+               config.hooks.create_runtime[0].args.size() == 2 &&
+               config.hooks.create_runtime[0].timeout == 5,
+               "load_config createRuntime hook");
+    ctx.expect(config.hooks.poststop.size() == 1 &&
+               config.hooks.poststop[0].path == "/bin/cleanup",
+               "load_config poststop hook");
+
+    // Missing process.args must still throw, whichever parse path runs.
+    {
+        std::ofstream ofs(bundle + "/config.json");
+        ofs << R"({"ociVersion": "1.0.2", "root": {"path": "rootfs"}, "process": {}})";
+    }
+    bool threw = false;
+    try {
+        load_config(bundle);
+    } catch (const std::exception&) {
+        threw = true;
+    }
+    ctx.expect(threw, "load_config missing args throws");
+
+    unlink((bundle + "/config.json").c_str());
+    rmdir(bundle.c_str());
+}
+
 void test_record_event(TestContext& ctx) {
     const std::string root = test_state_root();
     const std::string container_id = "event-test";
@@ -135,19 +225,16 @@ void test_record_event(TestContext& ctx) {
     record_state_event(state);
     std::string events_path = events_file_path(container_id);
     std::ifstream ifs(events_path);
-    ctx.expect(static_cast<bool>(ifs), "record_event file exists", events_path);
-    if (ifs) {
-        std::string line;
-        std::getline(ifs, line);
-        ctx.expect(!line.empty(), "record_event line non-empty");
-        if (!line.empty()) {
-            json entry = json::parse(line, nullptr, false);
-            ctx.expect(!entry.is_discarded(), "record_event parses as json");
-            ctx.expect(entry["type"] == "state", "record_event type field");
-            ctx.expect(entry["id"] == container_id, "record_event id field");
-            ctx.expect(entry["data"]["status"] == "created", "record_event status field");
-            ctx.expect(entry["data"]["pid"] == 42, "record_event pid field");
-        }
+    ctx.expect(static_cast<bool>(ifs), "record_event journal exists", events_path);
+    std::vector<std::string> payloads = read_event_journal_payloads(container_id);
+    ctx.expect(!payloads.empty(), "record_event journal non-empty");
+    if (!payloads.empty()) {
+        json entry = json::parse(payloads.front(), nullptr, false);
+        ctx.expect(!entry.is_discarded(), "record_event parses as json");
+        ctx.expect(entry["type"] == "state", "record_event type field");
+        ctx.expect(entry["id"] == container_id, "record_event id field");
+        ctx.expect(entry["data"]["status"] == "created", "record_event status field");
+        ctx.expect(entry["data"]["pid"] == 42, "record_event pid field");
     }
     cleanup_state_root(root, container_id);
 }
@@ -159,6 +246,7 @@ int main() {
     test_collect_process_tree(ctx);
     test_parse_exec_options(ctx);
     test_parse_events_options(ctx);
+    test_load_config_sax(ctx);
     test_record_event(ctx);
 
     std::cout << "[TEST SUMMARY] Passed: " << ctx.passed << ", Failed: " << ctx.failed << std::endl;